@@ -0,0 +1,1002 @@
+//Benchmarks of Headgets, running on headless backend so results are comparable between machines and platforms.
+//Build with CMake (target HeadgetsBenchmark) or directly:
+//	g++ -std=c++11 -O2 Benchmark.cpp -o benchmark -pthread
+//
+//Usage: benchmark [--json] [--filter=text] [--min-time=ms] [--repetitions=n] [--list]
+//	--json          machine-readable results on stdout (see printJson() for format)
+//	--filter=text   runs only benchmarks whose name contains text
+//	--min-time=ms   minimum duration of one sample (default 50)
+//	--repetitions=n samples per benchmark (default 5), median is the figure to track
+
+#ifndef HDG_HEADLESS
+#define HDG_HEADLESS 1
+#endif
+
+#include "Headgets.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+/*============== Allocation counting ===========*/
+
+static std::atomic<unsigned long long> allocations(0);
+
+//Not inlined into operators, otherwise GCC sees malloc() and free() behind new and delete and reports them as mismatched
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static void* countedAllocate(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	void* ptr = std::malloc(size != 0 ? size : 1);
+	if (ptr == NULL) throw std::bad_alloc();
+	return ptr;
+}
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static void countedRelease(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void* operator new(size_t size) {
+	return countedAllocate(size);
+}
+
+void* operator new[](size_t size) {
+	return countedAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+	countedRelease(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+	countedRelease(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+	countedRelease(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+	countedRelease(ptr);
+}
+
+namespace bench {
+
+	/*============== Harness ===========*/
+
+	struct Options {
+		bool json;
+		bool list;
+		std::string filter;
+		double minTime;
+		int repetitions;
+	};
+
+	struct Result {
+		std::string name;
+
+		//Operations per sample
+		size_t iterations;
+
+		//Nanoseconds per operation of each sample, sorted
+		std::vector<double> samples;
+
+		//Heap allocations per operation, in the first sample
+		double allocations;
+
+		//Counters of headless backend per operation, in the first sample (see Run::count())
+		std::vector<std::pair<std::string, double>> counters;
+	};
+
+	//Keeps computed values alive, so optimizer can't remove benchmarked code
+	static volatile unsigned long long sink;
+
+	static void keep(unsigned long long value) {
+		sink = sink + value;
+	}
+
+	//Passed to benchmark, which prepares its data and calls measure() with the code to time
+	class Run {
+	public:
+		Run(const bench::Options& _options, bench::Result& _result) : options(_options), result(_result) {}
+
+		//Reports given counter of headless backend per operation, e.g. run.count("text_bytes", &hdg::headless::Stats::textBytes).
+		//Call before measure().
+		void count(const char* name, unsigned long long hdg::headless::Stats::*counter) {
+			counters.push_back(std::make_pair(name, counter));
+		}
+
+		//Kernel performs given amount of operations: void kernel(size_t n)
+		template<typename F>
+		void measure(F kernel) {
+			//Grows amount of operations until one sample lasts at least minTime
+			size_t n = 1;
+			for (;;) {
+				double elapsed = time(kernel, n);
+				if (elapsed >= options.minTime || n >= 1000000000) break;
+
+				double factor = elapsed < options.minTime / 10 ? 10 : options.minTime / elapsed * 1.2;
+				n = (size_t) (n * factor) + 1;
+			}
+
+			result.iterations = n;
+			result.samples.clear();
+
+			for (int i = 0; i < options.repetitions; i++) {
+				unsigned long long before = allocations.load(std::memory_order_relaxed);
+				hdg::headless::Stats statsBefore = hdg::headless::stats();
+				double elapsed = time(kernel, n);
+
+				if (i == 0) {
+					result.allocations = (double) (allocations.load(std::memory_order_relaxed) - before) / n;
+
+					hdg::headless::Stats statsAfter = hdg::headless::stats();
+					result.counters.clear();
+					for (size_t j = 0; j < counters.size(); j++) {
+						unsigned long long hdg::headless::Stats::*counter = counters[j].second;
+						result.counters.push_back(std::make_pair(counters[j].first, (double) (statsAfter.*counter - statsBefore.*counter) / n));
+					}
+				}
+				result.samples.push_back(elapsed / n);
+			}
+
+			std::sort(result.samples.begin(), result.samples.end());
+		}
+	private:
+		//Nanoseconds
+		template<typename F>
+		static double time(F& kernel, size_t n) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			kernel(n);
+			return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		const bench::Options& options;
+		bench::Result& result;
+
+		std::vector<std::pair<std::string, unsigned long long hdg::headless::Stats::*>> counters;
+	};
+
+	struct Benchmark {
+		const char* name;
+		void (*body)(bench::Run& run);
+
+		//Benchmark creates its own applications, the shared one is destroyed before it runs
+		bool ownApplication;
+	};
+
+	static double median(const std::vector<double>& sorted) {
+		if (sorted.empty()) return 0;
+
+		size_t half = sorted.size() / 2;
+		return sorted.size() % 2 ? sorted[half] : (sorted[half - 1] + sorted[half]) / 2;
+	}
+
+	static std::string compilerName() {
+#if defined(__clang__)
+		return "clang " __clang_version__;
+#elif defined(__GNUC__)
+		return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+		char version[32];
+		std::snprintf(version, sizeof(version), "msvc %d", _MSC_FULL_VER);
+		return version;
+#else
+		return "unknown";
+#endif
+	}
+
+	static std::string jsonString(const std::string& str) {
+		std::string out = "\"";
+		for (size_t i = 0; i < str.size(); i++) {
+			unsigned char c = (unsigned char) str[i];
+
+			if (c == '"' || c == '\\') {
+				out += '\\';
+				out += (char) c;
+			} else if (c < 0x20) {
+				char escaped[8];
+				std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+				out += escaped;
+			} else {
+				out += (char) c;
+			}
+		}
+		return out + "\"";
+	}
+
+	//Format (version is increased on incompatible changes):
+	//{"format": 1, "backend": "headless", "compiler": "...", "sse2": true, "min_time_ms": 50, "repetitions": 5,
+	// "benchmarks": [{"name": "dispatch/typed", "iterations": 1000, "ns_per_op": 1.5, "ns_min": 1.4, "ns_max": 1.7, "allocs_per_op": 0}, ...]}
+	//Benchmarks which count work of backend also have "counters": {"text_bytes": 12.5, ...} (per operation).
+	static void printJson(const bench::Options& options, const std::vector<bench::Result>& results) {
+#ifdef HDG_SSE2
+		const char* sse2 = "true";
+#else
+		const char* sse2 = "false";
+#endif
+		std::printf("{\n\t\"format\": 1,\n\t\"backend\": \"headless\",\n\t\"compiler\": %s,\n\t\"sse2\": %s,\n",
+			jsonString(compilerName()).c_str(), sse2);
+		std::printf("\t\"min_time_ms\": %g,\n\t\"repetitions\": %d,\n\t\"benchmarks\": [", options.minTime / 1e6, options.repetitions);
+
+		for (size_t i = 0; i < results.size(); i++) {
+			const bench::Result& r = results[i];
+			std::printf("%s\n\t\t{\"name\": %s, \"iterations\": %zu, \"ns_per_op\": %.3f, \"ns_min\": %.3f, \"ns_max\": %.3f, \"allocs_per_op\": %.3f",
+				i > 0 ? "," : "", jsonString(r.name).c_str(), r.iterations, median(r.samples), r.samples.front(), r.samples.back(), r.allocations);
+
+			if (!r.counters.empty()) {
+				std::printf(", \"counters\": {");
+				for (size_t j = 0; j < r.counters.size(); j++) {
+					std::printf("%s%s: %.6g", j > 0 ? ", " : "", jsonString(r.counters[j].first).c_str(), r.counters[j].second);
+				}
+				std::printf("}");
+			}
+
+			std::printf("}");
+		}
+
+		std::printf("\n\t]\n}\n");
+	}
+
+	static void printTable(const bench::Result& r) {
+		std::printf("%-40s %12.1f ns/op  (min %.1f, max %.1f)  %8.2f allocs/op  %zu ops",
+			r.name.c_str(), median(r.samples), r.samples.front(), r.samples.back(), r.allocations, r.iterations);
+
+		for (size_t i = 0; i < r.counters.size(); i++) std::printf("  %.3g %s/op", r.counters[i].second, r.counters[i].first.c_str());
+
+		std::printf("\n");
+		std::fflush(stdout);
+	}
+
+	/*============== Event dispatch ===========*/
+
+	static void legacyTable(bench::Run& run) {
+		hdg::EventHandlerTable table;
+		unsigned long long sum = 0;
+		table.set(hdg::EventType::Command, 1, [&sum](hdg::Event ev){ sum += ev.num1; });
+
+		hdg::Event ev = {hdg::EventType::Command, 0, 0, hdg::MouseEvent::Nothing, NULL, hdg::Application::instance};
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				ev.num1 = (int) i;
+				table.dispatch(1, ev);
+			}
+		});
+		keep(sum);
+	}
+
+	static void typedSlots(bench::Run& run) {
+		hdg::HandlerSlots<hdg::TypedHandler<hdg::ClickEvent>> slots;
+		unsigned long long sum = 0;
+		slots.set(1, [&sum](const hdg::ClickEvent& ev){ sum += ev.id; });
+
+		hdg::ClickEvent ev = {hdg::Application::instance, NULL, 1};
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				ev.id = (UINT) i;
+				slots.dispatch(1, ev);
+			}
+		});
+		keep(sum);
+	}
+
+	//Full path: queued WM_COMMAND, message loop, window procedure, typed handler
+	static void clickMessage(bench::Run& run) {
+		hdg::Application& app = *hdg::Application::instance;
+		hdg::Button button("Button");
+		unsigned long long clicks = 0;
+		button.on<hdg::ClickEvent>([&clicks](const hdg::ClickEvent&){ clicks++; });
+
+		HWND hwnd = button.getNativeHandle();
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				hdg::headless::click(hwnd);
+				if ((i & 255) == 255) app.pumpEvents();
+			}
+			app.pumpEvents();
+		});
+		keep(clicks);
+	}
+
+	static void postDrain(bench::Run& run) {
+		hdg::Application& app = *hdg::Application::instance;
+		unsigned long long calls = 0;
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				app.post([&calls](){ calls++; });
+				if ((i & 255) == 255) app.pumpEvents();
+			}
+			app.pumpEvents();
+		});
+		keep(calls);
+	}
+
+	//Mouse moves merged into one event per UI loop iteration
+	static void mouseCoalesced(bench::Run& run) {
+		hdg::Application& app = *hdg::Application::instance;
+		unsigned long long moves = 0;
+		app.on<hdg::MouseMoveEvent>([&moves](const hdg::MouseMoveEvent&){ moves++; });
+		app.setMouseCoalescing(true, 0);
+
+		HWND hwnd = app.getNativeHandle();
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				hdg::headless::mouseMove(hwnd, (int) (i & 511), (int) ((i >> 9) & 511));
+				if ((i & 255) == 255) app.pumpEvents();
+			}
+			app.pumpEvents();
+		});
+
+		app.setMouseCoalescing(false);
+		app.on<hdg::MouseMoveEvent>(nullptr);
+		keep(moves);
+	}
+
+	/*============== Text ===========*/
+
+	static void measureAscii(bench::Run& run) {
+		hdg::TextMetrics& metrics = hdg::TextMetrics::get();
+		std::string text = "The quick brown fox jumps over 13 lazy dogs";
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) keep(metrics.measure(NULL, text).cx);
+		});
+	}
+
+	static std::vector<std::string> unicodeTexts(size_t count) {
+		std::vector<std::string> texts;
+		for (size_t i = 0; i < count; i++) texts.push_back("Gr\xC3\xBC\xC3\x9F" "e " + std::to_string(i));
+		return texts;
+	}
+
+	static void measureUnicodeCached(bench::Run& run) {
+		hdg::TextMetrics& metrics = hdg::TextMetrics::get();
+		std::vector<std::string> texts = unicodeTexts(64);
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) keep(metrics.measure(NULL, texts[i & 63]).cx);
+		});
+	}
+
+	static void measureUnicodeUncached(bench::Run& run) {
+		hdg::TextMetrics& metrics = hdg::TextMetrics::get();
+		std::vector<std::string> texts = unicodeTexts(64);
+		metrics.setCacheCapacity(0);
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) keep(metrics.measure(NULL, texts[i & 63]).cx);
+		});
+
+		metrics.setCacheCapacity(4096);
+	}
+
+	//One operation is a batch of 100 strings
+	static void measureBatch(bench::Run& run) {
+		hdg::TextMetrics& metrics = hdg::TextMetrics::get();
+		std::vector<std::string> texts;
+		for (int i = 0; i < 100; i++) texts.push_back("Row " + std::to_string(i) + " of the table");
+
+		std::vector<SIZE> sizes;
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				metrics.measure(NULL, texts, sizes);
+				keep(sizes[i % 100].cx);
+			}
+		});
+	}
+
+	//Conversion for wide Win32 functions, one operation is a 1 KB text
+	static void utf16Convert(bench::Run& run, const char* piece) {
+		std::string text;
+		while (text.size() < 1024) text += piece;
+
+		hdg::WideText wide;
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) keep(wide.assign(text)[i & 511]);
+		});
+	}
+
+	static void utf16Ascii(bench::Run& run) {
+		utf16Convert(run, "The quick brown fox jumps over 13 lazy dogs. ");
+	}
+
+	static void utf16Mixed(bench::Run& run) {
+		utf16Convert(run, "Stra\xC3\x9F" "e und Gr\xC3\xB6\xC3\x9F" "e, \xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82! ");
+	}
+
+	//High-rate updates of a label with changing text
+	static void labelSetText(bench::Run& run) {
+		hdg::Label label("0", 0, 0);
+		char buffer[32];
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				std::snprintf(buffer, sizeof(buffer), "Progress: %u", (unsigned) i);
+				label.setText(buffer);
+			}
+		});
+	}
+
+	/*============== Editbox ===========*/
+
+	static void editboxValueCached(bench::Run& run) {
+		hdg::Editbox edit;
+		edit.setText("Some value typed by user");
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) keep(edit.value().size());
+		});
+	}
+
+	//Each read follows a change made by user
+	static void editboxValueAfterEdit(bench::Run& run) {
+		hdg::Editbox edit;
+		HWND hwnd = edit.getNativeHandle();
+		const std::string texts[2] = {"Some value typed by user", "Other value typed by user"};
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				hdg::headless::typeText(hwnd, texts[i & 1]);
+				keep(edit.value().size());
+			}
+		});
+	}
+
+	//64 KB text where one character in the middle changes
+	static void editboxDeltaUpdate(bench::Run& run) {
+		hdg::Editbox edit(hdg::EditboxStyle::Multiline);
+		edit.setMaxLength(0);
+
+		std::string texts[2];
+		texts[0].assign(65536, 'a');
+		texts[1] = texts[0];
+		texts[1][32768] = 'b';
+
+		edit.setText(texts[0]);
+
+		run.count("text_bytes", &hdg::headless::Stats::textBytes);
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) edit.setText(texts[(i + 1) & 1]);
+		});
+		keep(edit.length());
+	}
+
+	//64 KB text replaced by completely different one, the whole text is sent to the control
+	static void editboxFullUpdate(bench::Run& run) {
+		hdg::Editbox edit(hdg::EditboxStyle::Multiline);
+		edit.setMaxLength(0);
+
+		std::string texts[2];
+		texts[0].assign(65536, 'a');
+		texts[1].assign(65536, 'b');
+
+		edit.setText(texts[0]);
+
+		run.count("text_bytes", &hdg::headless::Stats::textBytes);
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) edit.setText(texts[(i + 1) & 1]);
+		});
+		keep(edit.length());
+	}
+
+	//Log view: one line appended at a time, cleared when it reaches 1 MB
+	static void editboxAppendLine(bench::Run& run) {
+		hdg::Editbox edit(hdg::EditboxStyle::Multiline);
+		edit.setMaxLength(0);
+
+		char line[64];
+
+		run.count("text_bytes", &hdg::headless::Stats::textBytes);
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				if (edit.length() >= 1024 * 1024) edit.setText("");
+
+				std::snprintf(line, sizeof(line), "[%08u] Worker finished task\r\n", (unsigned) i);
+				edit.append(line);
+			}
+		});
+		keep(edit.length());
+	}
+
+	/*============== Progressbar ===========*/
+
+	//Native messages and repaints show how much of the work reaches the control
+	static void countProgress(bench::Run& run) {
+		run.count("messages_sent", &hdg::headless::Stats::messagesSent);
+		run.count("repaints", &hdg::headless::Stats::repaints);
+	}
+
+	static void progressDirect(bench::Run& run) {
+		hdg::Progressbar bar(false);
+		bar.setRange(0, 1000);
+
+		countProgress(run);
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) bar.step(1);
+		});
+		keep(bar.getPosition());
+	}
+
+	static void progressCoalesced(bench::Run& run) {
+		hdg::Application& app = *hdg::Application::instance;
+		hdg::Progressbar bar(false);
+		bar.setRange(0, 1000);
+		bar.setCoalesced(true);
+
+		countProgress(run);
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				bar.step(1);
+				//Full bar is shown, then it starts again
+				if ((i & 1023) == 1023) {
+					app.pumpEvents();
+					bar.setPosition(0);
+				}
+			}
+			app.pumpEvents();
+		});
+		keep(bar.getPosition());
+	}
+
+	//Worker threads step the bar while UI thread shows progress, one operation is one step
+	static void progressProducers(bench::Run& run) {
+		hdg::Application& app = *hdg::Application::instance;
+		hdg::Progressbar bar(false);
+		bar.setRange(0, 1000);
+		bar.setCoalesced(true);
+
+		const size_t Producers = 4;
+
+		countProgress(run);
+		run.measure([&](size_t n){
+			std::atomic<size_t> finished(0);
+			std::vector<std::thread> threads;
+
+			for (size_t t = 0; t < Producers; t++) {
+				size_t steps = n / Producers + (t < n % Producers ? 1 : 0);
+
+				threads.emplace_back([&bar, &finished, steps](){
+					for (size_t i = 0; i < steps; i++) bar.step(1);
+					finished.fetch_add(1);
+				});
+			}
+
+			//Bar starts again when it is full, like for a sequence of jobs
+			while (finished.load() != Producers) {
+				app.pumpEvents();
+				if (bar.getPosition() >= 1000) bar.setPosition(0);
+				std::this_thread::yield();
+			}
+
+			for (size_t t = 0; t < Producers; t++) threads[t].join();
+			app.pumpEvents();
+		});
+		keep(bar.getPosition());
+	}
+
+	/*============== Widgets ===========*/
+
+	static void createDestroy(bench::Run& run) {
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				hdg::Label* label = new hdg::Label("Label", 0, (int) (i & 255));
+				delete label;
+			}
+		});
+	}
+
+	static void createDestroyPooled(bench::Run& run) {
+		hdg::Application& app = *hdg::Application::instance;
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				hdg::Handle<hdg::Label> label = app.create<hdg::Label>("Label", 0, (int) (i & 255));
+				app.destroy(label);
+			}
+		});
+	}
+
+	static const hdg::form::Grid formGrid(8, 8, 120, 24);
+
+	static const hdg::WidgetSpec formSpecs[] = {
+		hdg::form::label("Name", formGrid.at(0, 0)), hdg::form::editbox(hdg::EditboxStyle::None, formGrid.at(0, 1, 2)),
+		hdg::form::label("Email", formGrid.at(1, 0)), hdg::form::editbox(hdg::EditboxStyle::None, formGrid.at(1, 1, 2)),
+		hdg::form::label("Phone", formGrid.at(2, 0)), hdg::form::editbox(hdg::EditboxStyle::Number, formGrid.at(2, 1, 2)),
+		hdg::form::label("City", formGrid.at(3, 0)), hdg::form::editbox(hdg::EditboxStyle::None, formGrid.at(3, 1, 2)),
+		hdg::form::label("Street", formGrid.at(4, 0)), hdg::form::editbox(hdg::EditboxStyle::None, formGrid.at(4, 1, 2)),
+		hdg::form::label("Notes", formGrid.at(5, 0)), hdg::form::editbox(hdg::EditboxStyle::Multiline, formGrid.at(5, 1, 2, 4)),
+		hdg::form::progressbar(false, formGrid.at(9, 0, 3)),
+		hdg::form::button("Load", formGrid.at(10, 0)), hdg::form::button("Save", formGrid.at(10, 1)), hdg::form::button("Close", formGrid.at(10, 2)),
+		hdg::form::label("Status", formGrid.at(11, 0, 3)), hdg::form::label("", formGrid.at(12, 0, 3)),
+		hdg::form::button("Help", formGrid.at(13, 0)), hdg::form::button("About", formGrid.at(13, 1))
+	};
+
+	//One operation is creation and destruction of a form with 20 widgets
+	static void staticForm(bench::Run& run) {
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				hdg::StaticForm<hdg::form::count(formSpecs)> form(formSpecs);
+				keep(form.getID(0));
+			}
+		});
+	}
+
+	/*============== Startup ===========*/
+
+	//Configurator with 20 pages of 20 widgets, only the first page is visible at start
+	static const int ConfiguratorPages = 20;
+
+	//One operation is cold start: application, all pages, and message loop until it's ready
+	static void configuratorStartup(bench::Run& run, hdg::FormCreation hiddenPages) {
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				hdg::Application app(NULL, "Configurator", 1000, 800);
+
+				std::vector<std::unique_ptr<hdg::StaticForm<hdg::form::count(formSpecs)>>> pages;
+				for (int page = 0; page < ConfiguratorPages; page++) {
+					hdg::FormCreation creation = page == 0 ? hdg::FormCreation::Immediate : hiddenPages;
+					pages.emplace_back(new hdg::StaticForm<hdg::form::count(formSpecs)>(formSpecs, creation));
+					if (page != 0) pages.back()->hide();
+				}
+
+				app.pumpEvents();
+				keep(app.getStartupStats().windowsCreated);
+			}
+		});
+	}
+
+	static void configuratorEager(bench::Run& run) {
+		configuratorStartup(run, hdg::FormCreation::Immediate);
+	}
+
+	static void configuratorLazy(bench::Run& run) {
+		configuratorStartup(run, hdg::FormCreation::Lazy);
+	}
+
+	/*============== Layout ===========*/
+
+	//Form with rows of label, editbox and button
+	struct LargeForm {
+		static const int Rows = 250;
+
+		hdg::LayoutBox root;
+		std::vector<std::unique_ptr<hdg::Widget>> widgets;
+
+		LargeForm() : root(hdg::LayoutDirection::Column) {
+			root.setPadding(8);
+			root.setSpacing(2);
+
+			for (int i = 0; i < Rows; i++) {
+				hdg::LayoutBox& row = root.addBox(hdg::LayoutDirection::Row, 20, 0);
+				row.setSpacing(4);
+
+				widgets.push_back(std::unique_ptr<hdg::Widget>(new hdg::Label("Field " + std::to_string(i))));
+				row.add(*widgets.back(), 80);
+				widgets.push_back(std::unique_ptr<hdg::Widget>(new hdg::Editbox()));
+				row.add(*widgets.back(), 0, 1);
+				widgets.push_back(std::unique_ptr<hdg::Widget>(new hdg::Button("...")));
+				row.add(*widgets.back(), 40);
+			}
+		}
+	};
+
+	//Window resized by user: every widget moves or changes size
+	static void layoutResize(bench::Run& run) {
+		hdg::Application& app = *hdg::Application::instance;
+		LargeForm form;
+		app.setLayout(&form.root);
+
+		HWND hwnd = app.getNativeHandle();
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) hdg::headless::resize(hwnd, 1000 + (int) (i & 1) * 40, 800);
+		});
+
+		app.setLayout(NULL);
+	}
+
+	//One row changed: incremental layout arranges only affected boxes
+	static void layoutIncremental(bench::Run& run) {
+		hdg::Application& app = *hdg::Application::instance;
+		LargeForm form;
+		app.setLayout(&form.root);
+
+		hdg::LayoutBox& row = form.root.addBox(hdg::LayoutDirection::Row, 20, 0);
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				row.setSpacing((int) (i & 7));
+				app.relayout();
+			}
+		});
+
+		app.setLayout(NULL);
+	}
+
+	//One operation moves all widgets of large form in one geometry transaction
+	static void geometryTransaction(bench::Run& run) {
+		hdg::Application& app = *hdg::Application::instance;
+		LargeForm form;
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				app.beginUpdate();
+				for (size_t j = 0; j < form.widgets.size(); j++) form.widgets[j]->setPosition((int) (i & 15), (int) j * 3);
+				app.endUpdate();
+			}
+		});
+	}
+
+	/*============== ListView ===========*/
+
+	class NumberSource : public hdg::ListViewSource {
+	public:
+		size_t rowCount() {
+			return 1000000;
+		}
+
+		std::string cell(size_t row, size_t column) {
+			return column == 0 ? std::to_string(row) : "Item " + std::to_string(row * 7);
+		}
+	};
+
+	//Jumps to distant rows of million-row table
+	static void listViewScroll(bench::Run& run) {
+		NumberSource source;
+		hdg::ListView list(&source, 0, 0, 400, 300);
+		list.addColumn("Number");
+		list.addColumn("Text", 200);
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) list.scrollTo((i * 7919) % 1000000);
+		});
+		keep(list.getStats().cellsFetched);
+	}
+
+	/*============== Canvas and images ===========*/
+
+	//Small change of 512x512 canvas, presented every time
+	static void canvasFillPresent(bench::Run& run) {
+		hdg::Application& app = *hdg::Application::instance;
+		hdg::Canvas canvas(0, 0, 512, 512);
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				canvas.fillRect((int) (i * 37) & 511, (int) (i * 91) & 511, 16, 16, (hdg::Color) i | 0xFF000000u);
+				canvas.present();
+				if ((i & 255) == 255) app.pumpEvents();
+			}
+			app.pumpEvents();
+		});
+	}
+
+	static void scaleImage(bench::Run& run, hdg::ScaleFilter filter) {
+		hdg::Raster src(1024, 768);
+		for (int y = 0; y < src.getHeight(); y++) {
+			for (int x = 0; x < src.getWidth(); x++) src.setPixel(x, y, 0xFF000000u | (uint32_t) (x * 255 / 1024) << 16 | (uint32_t) (y * 255 / 768) << 8);
+		}
+
+		hdg::Raster dst(256, 192);
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) {
+				hdg::scaleRaster(src, dst, filter);
+				keep(dst.getPixel(0, 0));
+			}
+		});
+	}
+
+	static void scaleBox(bench::Run& run) {
+		scaleImage(run, hdg::ScaleFilter::Box);
+	}
+
+	static void scaleBilinear(bench::Run& run) {
+		scaleImage(run, hdg::ScaleFilter::Bilinear);
+	}
+
+	/*============== Recording ===========*/
+
+	//Replays session of 1000 events (typing, clicks, mouse moves, keys) as fast as possible, one operation is one event
+	static void replaySession(bench::Run& run) {
+		hdg::Application& app = *hdg::Application::instance;
+		hdg::Editbox edit;
+		hdg::Button button("OK");
+		unsigned long long events = 0;
+
+		button.on<hdg::ClickEvent>([&](const hdg::ClickEvent&){ events += edit.value().size(); });
+		app.on<hdg::MouseMoveEvent>([&events](const hdg::MouseMoveEvent&){ events++; });
+		app.on<hdg::KeyEvent>([&events](const hdg::KeyEvent&){ events++; });
+
+		const char* path = "headgets_benchmark.rec";
+		if (!app.startRecording(path)) return;
+
+		std::string text;
+		for (int i = 0; i < 200; i++) {
+			text += (char) ('a' + i % 26);
+			hdg::headless::typeText(edit.getNativeHandle(), text);
+			hdg::headless::key(edit.getNativeHandle(), 'A' + i % 26, true);
+			hdg::headless::key(edit.getNativeHandle(), 'A' + i % 26, false);
+			hdg::headless::mouseMove(app.getNativeHandle(), i, i * 2);
+			hdg::headless::click(button.getNativeHandle());
+			app.pumpEvents();
+		}
+
+		app.stopRecording();
+
+		run.measure([&](size_t n){
+			hdg::ReplayStats stats = hdg::ReplayStats();
+			for (size_t done = 0; done < n; done += (size_t) std::max<unsigned long long>(stats.events, 1)) {
+				app.replay(path, hdg::ReplaySpeed::Fastest, &stats);
+			}
+		});
+
+		std::remove(path);
+		app.on<hdg::MouseMoveEvent>(nullptr);
+		app.on<hdg::KeyEvent>(nullptr);
+		keep(events);
+	}
+
+	/*============== Timers and background work ===========*/
+
+	//Timer added and cancelled while 10000 others are pending
+	static void timerAddCancel(bench::Run& run) {
+		hdg::TimerWheel wheel(0);
+		for (int i = 0; i < 10000; i++) wheel.add(1 + i * 37 % 100000, 0, [](){});
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i++) wheel.cancel(wheel.add(1 + i % 60000, 0, [](){}));
+		});
+	}
+
+	//Periodic timers firing each millisecond, one operation is one fired timer
+	static void timerFire(bench::Run& run) {
+		hdg::TimerWheel wheel(0);
+		unsigned long long fired = 0;
+		for (int i = 0; i < 100; i++) wheel.add(1, 1, [&fired](){ fired++; });
+
+		uint64_t now = 0;
+
+		run.measure([&](size_t n){
+			for (size_t i = 0; i < n; i += 100) wheel.advance(++now);
+		});
+		keep(fired);
+	}
+
+	static void poolSubmit(bench::Run& run) {
+		hdg::ThreadPool& pool = hdg::ThreadPool::get();
+		std::atomic<size_t> done(0);
+
+		run.measure([&](size_t n){
+			done.store(0);
+			for (size_t i = 0; i < n; i++) pool.submit([&done](){ done.fetch_add(1, std::memory_order_relaxed); });
+			while (done.load() != n) std::this_thread::yield();
+		});
+	}
+
+	static const bench::Benchmark benchmarks[] = {
+		{"dispatch/legacy_table", legacyTable, false},
+		{"dispatch/typed_slots", typedSlots, false},
+		{"dispatch/click_message", clickMessage, false},
+		{"dispatch/post_drain", postDrain, false},
+		{"dispatch/mouse_move_coalesced", mouseCoalesced, false},
+		{"text/measure_ascii", measureAscii, false},
+		{"text/measure_unicode_cached", measureUnicodeCached, false},
+		{"text/measure_unicode_uncached", measureUnicodeUncached, false},
+		{"text/measure_batch_100", measureBatch, false},
+		{"text/utf16_ascii_1k", utf16Ascii, false},
+		{"text/utf16_mixed_1k", utf16Mixed, false},
+		{"text/label_set_text", labelSetText, false},
+		{"editbox/value_cached", editboxValueCached, false},
+		{"editbox/value_after_edit", editboxValueAfterEdit, false},
+		{"editbox/set_text_delta_64k", editboxDeltaUpdate, false},
+		{"editbox/set_text_full_64k", editboxFullUpdate, false},
+		{"editbox/append_line_1mb", editboxAppendLine, false},
+		{"progressbar/step", progressDirect, false},
+		{"progressbar/step_coalesced", progressCoalesced, false},
+		{"progressbar/step_coalesced_4_threads", progressProducers, false},
+		{"widgets/create_destroy", createDestroy, false},
+		{"widgets/create_destroy_pooled", createDestroyPooled, false},
+		{"widgets/static_form_20", staticForm, false},
+		{"startup/configurator_400_eager", configuratorEager, true},
+		{"startup/configurator_400_lazy", configuratorLazy, true},
+		{"layout/resize_750_widgets", layoutResize, false},
+		{"layout/incremental_one_row", layoutIncremental, false},
+		{"layout/transaction_750_widgets", geometryTransaction, false},
+		{"listview/scroll_1m_rows", listViewScroll, false},
+		{"replay/session_1000_events", replaySession, false},
+		{"canvas/fill_present", canvasFillPresent, false},
+		{"image/scale_box_1024_to_256", scaleBox, false},
+		{"image/scale_bilinear_1024_to_256", scaleBilinear, false},
+		{"timers/add_cancel", timerAddCancel, false},
+		{"timers/fire", timerFire, false},
+		{"pool/submit", poolSubmit, false}
+	};
+
+	static bool parseOptions(int argc, char** argv, bench::Options& options) {
+		options.json = false;
+		options.list = false;
+		options.minTime = 50e6;
+		options.repetitions = 5;
+
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+
+			if (arg == "--json") {
+				options.json = true;
+			} else if (arg == "--list") {
+				options.list = true;
+			} else if (arg.compare(0, 9, "--filter=") == 0) {
+				options.filter = arg.substr(9);
+			} else if (arg.compare(0, 11, "--min-time=") == 0) {
+				options.minTime = std::atof(arg.c_str() + 11) * 1e6;
+			} else if (arg.compare(0, 14, "--repetitions=") == 0) {
+				options.repetitions = std::atoi(arg.c_str() + 14);
+			} else {
+				std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+				return false;
+			}
+		}
+
+		if (options.minTime <= 0 || options.repetitions < 1) {
+			std::fprintf(stderr, "--min-time and --repetitions must be positive\n");
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv) {
+	bench::Options options;
+	if (!bench::parseOptions(argc, argv, options)) {
+		std::fprintf(stderr, "Usage: %s [--json] [--filter=text] [--min-time=ms] [--repetitions=n] [--list]\n", argv[0]);
+		return 2;
+	}
+
+	const size_t count = sizeof(bench::benchmarks) / sizeof(bench::benchmarks[0]);
+
+	if (options.list) {
+		for (size_t i = 0; i < count; i++) std::printf("%s\n", bench::benchmarks[i].name);
+		return 0;
+	}
+
+	std::unique_ptr<hdg::Application> app;
+
+	std::vector<bench::Result> results;
+	for (size_t i = 0; i < count; i++) {
+		const bench::Benchmark& benchmark = bench::benchmarks[i];
+		if (std::string(benchmark.name).find(options.filter) == std::string::npos) continue;
+
+		if (benchmark.ownApplication) {
+			app.reset();
+		} else if (!app) {
+			app.reset(new hdg::Application(NULL, "Benchmark", 1000, 800));
+		}
+
+		bench::Result result;
+		result.name = benchmark.name;
+		result.iterations = 0;
+		result.allocations = 0;
+
+		bench::Run run(options, result);
+		benchmark.body(run);
+
+		if (!options.json) bench::printTable(result);
+		results.push_back(result);
+	}
+
+	if (options.json) bench::printJson(options, results);
+	return 0;
+}
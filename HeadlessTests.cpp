@@ -0,0 +1,845 @@
+//Tests of Headgets, running on headless backend, so they run on any platform and in CI.
+//Build with CMake (target HeadgetsTests, run by ctest) or directly:
+//	g++ -std=c++11 HeadlessTests.cpp -o tests -pthread
+//
+//Usage: tests [--filter=text] [--list]
+//Prints failed checks and returns 1 if any test failed.
+
+#ifndef HDG_HEADLESS
+#define HDG_HEADLESS 1
+#endif
+
+#include "Headgets.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+namespace test {
+
+	/*============== Harness ===========*/
+
+	static int failedChecks = 0;
+	static int testFailures = 0;
+
+	static void check(bool ok, const char* expr, const char* file, int line) {
+		if (ok) return;
+
+		std::printf("  %s:%d: check failed: %s\n", file, line, expr);
+		testFailures++;
+	}
+
+	template <class A, class B>
+	static void checkEqual(const A& actual, const B& expected, const char* expr, const char* file, int line) {
+		if (actual == expected) return;
+
+		std::ostringstream message;
+		message << expr << " (got " << actual << ", expected " << expected << ")";
+		check(false, message.str().c_str(), file, line);
+	}
+
+	static void checkRect(const RECT& actual, int x, int y, int w, int h, const char* expr, const char* file, int line) {
+		if (actual.left == x && actual.top == y && actual.right - actual.left == w && actual.bottom - actual.top == h) return;
+
+		std::ostringstream message;
+		message << expr << " (got " << actual.left << "," << actual.top << " " << actual.right - actual.left << "x" << actual.bottom - actual.top
+			<< ", expected " << x << "," << y << " " << w << "x" << h << ")";
+		check(false, message.str().c_str(), file, line);
+	}
+
+	#define CHECK(expr) test::check((expr), #expr, __FILE__, __LINE__)
+	#define CHECK_EQ(actual, expected) test::checkEqual((actual), (expected), #actual " == " #expected, __FILE__, __LINE__)
+	#define CHECK_RECT(widget, x, y, w, h) test::checkRect(hdg::headless::getRect((widget).getNativeHandle()), x, y, w, h, #widget, __FILE__, __LINE__)
+
+	struct Test {
+		const char* name;
+		void (*body)();
+	};
+
+	static bool visible(hdg::Widget& widget) {
+		return hdg::headless::isVisible(widget.getNativeHandle());
+	}
+
+	/*============== Text encoding ===========*/
+
+	static void utf16Conversion() {
+		//2-byte, 3-byte and 4-byte (surrogate pair) characters after ASCII longer than one SSE2 block
+		std::string text = "ASCII prefix, 20 chr Gr\xC3\xBC\xC3\x9F" "e \xE2\x82\xAC \xF0\x9D\x84\x9E";
+
+		hdg::WideText wide(text);
+		CHECK_EQ(wide.size(), (size_t) 31);
+		CHECK_EQ(hdg::utf16Length(text), wide.size());
+
+		const char16_t* units = wide.c_str();
+		CHECK_EQ((int) units[0], (int) 'A');
+		CHECK_EQ((int) units[23], 0xFC);
+		CHECK_EQ((int) units[24], 0xDF);
+		CHECK_EQ((int) units[27], 0x20AC);
+		CHECK_EQ((int) units[29], 0xD834);
+		CHECK_EQ((int) units[30], 0xDD1E);
+		CHECK_EQ((int) units[31], 0);
+
+		std::string back;
+		hdg::utf16ToUtf8(units, wide.size(), back);
+		CHECK_EQ(back, text);
+	}
+
+	static void utf16InvalidInput() {
+		//Truncated sequence and lone continuation byte become U+FFFD
+		hdg::WideText wide(std::string("a\xC3" "b\x80"));
+		CHECK_EQ(wide.size(), (size_t) 4);
+		CHECK_EQ((int) wide.c_str()[1], 0xFFFD);
+		CHECK_EQ((int) wide.c_str()[2], (int) 'b');
+		CHECK_EQ((int) wide.c_str()[3], 0xFFFD);
+
+		//Unpaired surrogate
+		const char16_t lone[] = {u'x', 0xD800, u'y'};
+		std::string out;
+		hdg::utf16ToUtf8(lone, 3, out);
+		CHECK_EQ(out, std::string("x\xEF\xBF\xBDy"));
+	}
+
+	/*============== Queues and timers ===========*/
+
+	static void postQueueOrder() {
+		hdg::PostQueue queue;
+		std::string order;
+
+		CHECK(queue.push([&order](){ order += 'a'; }));
+		//Wakeup is requested once until consumer starts draining
+		CHECK(!queue.push([&order](){ order += 'b'; }));
+		CHECK_EQ(queue.depth(), (size_t) 2);
+
+		queue.beginDrain();
+
+		std::function<void()> fn;
+		unsigned long long time;
+		while (queue.pop(fn, time)) fn();
+
+		CHECK_EQ(order, std::string("ab"));
+		CHECK_EQ(queue.depth(), (size_t) 0);
+		CHECK(queue.push([&order](){ order += 'c'; }));
+	}
+
+	static void postQueueProducers() {
+		hdg::PostQueue queue;
+		const int Producers = 4;
+		const int Items = 20000;
+
+		unsigned long long sum = 0;
+		std::vector<int> last(Producers, -1);
+		bool ordered = true;
+
+		std::vector<std::thread> threads;
+		for (int t = 0; t < Producers; t++) {
+			threads.emplace_back([&, t](){
+				for (int i = 0; i < Items; i++) {
+					queue.push([&, t, i](){
+						sum += (unsigned long long) i;
+						if (last[t] != i - 1) ordered = false;
+						last[t] = i;
+					});
+				}
+			});
+		}
+
+		std::function<void()> fn;
+		unsigned long long time;
+		for (int popped = 0; popped < Producers * Items;) {
+			if (queue.pop(fn, time)) {
+				fn();
+				popped++;
+			} else {
+				std::this_thread::yield();
+			}
+		}
+
+		for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+
+		CHECK_EQ(sum, (unsigned long long) Producers * Items * (Items - 1) / 2);
+		CHECK(ordered);
+		CHECK_EQ(queue.depth(), (size_t) 0);
+	}
+
+	static void applicationPost() {
+		hdg::Application& app = *hdg::Application::instance;
+		std::thread::id ui = std::this_thread::get_id();
+
+		std::atomic<int> calls(0);
+		bool onUiThread = true;
+
+		std::thread worker([&](){
+			for (int i = 0; i < 100; i++) app.post([&](){ calls++; onUiThread = onUiThread && std::this_thread::get_id() == ui; });
+		});
+		worker.join();
+
+		CHECK_EQ(calls.load(), 0);
+		app.pumpEvents();
+		CHECK_EQ(calls.load(), 100);
+		CHECK(onUiThread);
+	}
+
+	static void timerWheelCascading() {
+		hdg::TimerWheel wheel(0);
+		std::vector<uint64_t> fired;
+
+		//Level 0, level 1 and level 2 of the wheel
+		wheel.add(10, 0, [&](){ fired.push_back(10); });
+		wheel.add(300, 0, [&](){ fired.push_back(300); });
+		wheel.add(70000, 0, [&](){ fired.push_back(70000); });
+		CHECK_EQ(wheel.size(), (size_t) 3);
+
+		wheel.advance(9);
+		CHECK(fired.empty());
+
+		wheel.advance(299);
+		CHECK_EQ(fired.size(), (size_t) 1);
+
+		wheel.advance(300);
+		CHECK_EQ(fired.size(), (size_t) 2);
+
+		wheel.advance(69999);
+		CHECK_EQ(fired.size(), (size_t) 2);
+		CHECK_EQ(wheel.nextWakeup() <= 70000, true);
+
+		wheel.advance(70000);
+		CHECK_EQ(fired.size(), (size_t) 3);
+		CHECK_EQ(fired[0], (uint64_t) 10);
+		CHECK_EQ(fired[1], (uint64_t) 300);
+		CHECK_EQ(fired[2], (uint64_t) 70000);
+		CHECK_EQ(wheel.size(), (size_t) 0);
+		CHECK(wheel.getStats().cascaded > 0);
+	}
+
+	static void timerWheelCancel() {
+		hdg::TimerWheel wheel(0);
+		int periodic = 0;
+		int once = 0;
+
+		hdg::TimerId repeated = wheel.add(5, 5, [&](){ periodic++; });
+		hdg::TimerId cancelled = wheel.add(20, 0, [&](){ once++; });
+
+		CHECK(wheel.cancel(cancelled));
+		CHECK(!wheel.cancel(cancelled));
+
+		for (uint64_t now = 1; now <= 24; now++) wheel.advance(now);
+		CHECK_EQ(periodic, 4);
+		CHECK_EQ(once, 0);
+
+		//Late by more than a period: missed runs are skipped
+		wheel.advance(60);
+		CHECK_EQ(periodic, 5);
+
+		CHECK(wheel.cancel(repeated));
+		wheel.advance(100);
+		CHECK_EQ(periodic, 5);
+
+		//Timer cancelling itself from its callback
+		hdg::TimerId self = 0;
+		int runs = 0;
+		self = wheel.add(110, 1, [&](){ runs++; wheel.cancel(self); });
+		wheel.advance(200);
+		CHECK_EQ(runs, 1);
+		CHECK_EQ(wheel.size(), (size_t) 0);
+
+		//Stale id doesn't cancel a timer reusing its slot
+		hdg::TimerId reused = wheel.add(210, 0, [&](){ once++; });
+		CHECK(!wheel.cancel(self));
+		wheel.advance(210);
+		CHECK_EQ(once, 1);
+		CHECK(!wheel.cancel(reused));
+	}
+
+	/*============== Events ===========*/
+
+	static void clickDispatch() {
+		hdg::Application& app = *hdg::Application::instance;
+		hdg::Button first("First");
+		hdg::Button second("Second");
+
+		std::vector<UINT> clicked;
+		first.on<hdg::ClickEvent>([&](const hdg::ClickEvent& ev){ clicked.push_back(ev.id); });
+		second.on<hdg::ClickEvent>([&](const hdg::ClickEvent& ev){ clicked.push_back(ev.id); });
+
+		hdg::headless::click(second.getNativeHandle());
+		hdg::headless::click(first.getNativeHandle());
+		app.pumpEvents();
+
+		CHECK_EQ(clicked.size(), (size_t) 2);
+		if (clicked.size() == 2) {
+			CHECK_EQ(clicked[0], second.getID());
+			CHECK_EQ(clicked[1], first.getID());
+		}
+
+		//Removed handler isn't called
+		first.on<hdg::ClickEvent>(nullptr);
+		hdg::headless::click(first.getNativeHandle());
+		app.pumpEvents();
+		CHECK_EQ(clicked.size(), (size_t) 2);
+	}
+
+	static void eventTypeNumbers() {
+		//Values are stored by applications and in recordings, so they must not change
+		CHECK_EQ((int) hdg::EventType::Closed, 5);
+		CHECK_EQ((int) hdg::EventType::Destroyed, 6);
+		CHECK_EQ((int) hdg::EventType::KeyPressed, 7);
+		CHECK_EQ(hdg::EventTypeCount, 10);
+	}
+
+	/*============== Widgets ===========*/
+
+	static void labelText() {
+		hdg::Label label("Start", 0, 0);
+		CHECK_EQ(hdg::headless::getText(label.getNativeHandle()), std::string("Start"));
+
+		hdg::headless::resetStats();
+		label.setText("Gr\xC3\xBC\xC3\x9F" "e");
+		label.setText("Gr\xC3\xBC\xC3\x9F" "e");
+
+		CHECK_EQ(hdg::headless::getText(label.getNativeHandle()), std::string("Gr\xC3\xBC\xC3\x9F" "e"));
+		CHECK_EQ(hdg::headless::stats().textChanges, 1ULL);
+	}
+
+	static void editboxDelta() {
+		hdg::Editbox edit(hdg::EditboxStyle::Multiline);
+		edit.setMaxLength(0);
+
+		std::string text(4096, 'a');
+		edit.setText(text);
+
+		//Only the changed span is sent to the control
+		hdg::headless::resetStats();
+		text[2000] = 'b';
+		text.insert(3000, "\xC3\xA9");
+		edit.setText(text);
+
+		CHECK_EQ(hdg::headless::getText(edit.getNativeHandle()), text);
+		CHECK_EQ(edit.value(), text);
+		CHECK(hdg::headless::stats().textBytes < 1100);
+
+		//Most of text changed: sent at once
+		hdg::headless::resetStats();
+		std::string other(4096, 'c');
+		edit.setText(other);
+		CHECK_EQ(hdg::headless::getText(edit.getNativeHandle()), other);
+		CHECK_EQ(hdg::headless::stats().textBytes, 4096ULL);
+
+		//Appending sends only the new text
+		hdg::headless::resetStats();
+		edit.append("tail");
+		CHECK_EQ(edit.value(), other + "tail");
+		CHECK_EQ(hdg::headless::stats().textBytes, 4ULL);
+	}
+
+	static void editboxUserInput() {
+		hdg::Application& app = *hdg::Application::instance;
+		hdg::Editbox edit;
+		edit.setText("before");
+		unsigned long long generation = edit.getGeneration();
+
+		hdg::headless::typeText(edit.getNativeHandle(), "typed");
+		app.pumpEvents();
+
+		CHECK_EQ(edit.value(), std::string("typed"));
+		CHECK(edit.getGeneration() != generation);
+	}
+
+	static void progressbarCoalesced() {
+		hdg::Application& app = *hdg::Application::instance;
+		hdg::Progressbar bar(false);
+		bar.setRange(0, 100);
+		bar.setCoalesced(true, 0);
+
+		hdg::headless::resetStats();
+		for (int i = 0; i < 30; i++) bar.step(1);
+
+		//Nothing reaches the control until UI loop runs
+		CHECK_EQ(bar.getPosition(), 30);
+		CHECK_EQ(hdg::headless::stats().messagesSent, 0ULL);
+
+		app.pumpEvents();
+		CHECK_EQ((int) hdg::platform::sendMessage(bar.getNativeHandle(), PBM_GETPOS, 0, 0), 30);
+
+		//Steps from other threads
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 4; t++) threads.emplace_back([&bar](){ for (int i = 0; i < 10; i++) bar.step(1); });
+		for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+
+		app.pumpEvents();
+		CHECK_EQ((int) hdg::platform::sendMessage(bar.getNativeHandle(), PBM_GETPOS, 0, 0), 70);
+
+		//Doesn't go over the maximum
+		for (int i = 0; i < 50; i++) bar.step(1);
+		app.pumpEvents();
+		CHECK_EQ((int) hdg::platform::sendMessage(bar.getNativeHandle(), PBM_GETPOS, 0, 0), 100);
+	}
+
+	static void pooledWidgets() {
+		hdg::Application& app = *hdg::Application::instance;
+
+		hdg::Handle<hdg::Label> label = app.create<hdg::Label>("Pooled", 0, 0);
+		CHECK(app.get(label) != NULL);
+		CHECK_EQ(hdg::headless::getText(app.get(label)->getNativeHandle()), std::string("Pooled"));
+
+		CHECK(app.destroy(label));
+		CHECK(app.get(label) == NULL);
+		CHECK(!app.destroy(label));
+
+		//New widget in the same slot gets a different handle
+		hdg::Handle<hdg::Label> next = app.create<hdg::Label>("Next", 0, 0);
+		CHECK(!(next == label));
+		CHECK(app.get(label) == NULL);
+		app.destroy(next);
+	}
+
+	class NumberSource : public hdg::ListViewSource {
+	public:
+		size_t rowCount() {
+			return 100000;
+		}
+
+		std::string cell(size_t row, size_t column) {
+			return (column == 0 ? "#" : "Item ") + std::to_string(row);
+		}
+	};
+
+	static void listViewCells() {
+		NumberSource source;
+		hdg::ListView list(&source, 0, 0, 400, 300);
+		list.addColumn("Number");
+		list.addColumn("Text", 200);
+
+		list.scrollTo(54321);
+		CHECK_EQ(hdg::headless::getListText(list.getNativeHandle(), 54321, 0), std::string("#54321"));
+		CHECK_EQ(hdg::headless::getListText(list.getNativeHandle(), 54321, 1), std::string("Item 54321"));
+
+		//Only visible rows are fetched
+		CHECK(list.getStats().cellsFetched < 1000);
+	}
+
+	/*============== Layout ===========*/
+
+	static void layoutPlacement() {
+		hdg::Application& app = *hdg::Application::instance;
+		hdg::headless::resize(app.getNativeHandle(), 400, 300);
+
+		hdg::Button a("A"), b("B");
+		hdg::Editbox edit;
+		hdg::Label status("Status");
+
+		hdg::LayoutBox root(hdg::LayoutDirection::Column);
+		root.setPadding(10);
+		root.setSpacing(5);
+
+		hdg::LayoutBox& bar = root.addBox(hdg::LayoutDirection::Row, 30, 0);
+		bar.setSpacing(4);
+		bar.add(a, 80);
+		bar.add(b, 0, 1);
+		root.add(edit, 0, 3);
+		root.add(status, 0, 1);
+
+		app.setLayout(&root);
+
+		CHECK_RECT(a, 10, 10, 80, 30);
+		CHECK_RECT(b, 94, 10, 296, 30);
+		//300 - 20 padding - 30 bar - 10 spacing = 240 shared 3:1
+		CHECK_RECT(edit, 10, 45, 380, 180);
+		CHECK_RECT(status, 10, 230, 380, 60);
+
+		hdg::headless::resize(app.getNativeHandle(), 500, 300);
+		CHECK_RECT(b, 94, 10, 396, 30);
+		CHECK_RECT(edit, 10, 45, 480, 180);
+
+		//Hidden box gives its space to siblings
+		bar.setVisible(false);
+		app.relayout();
+		CHECK(!visible(a));
+		CHECK(!visible(b));
+		//280 - 5 spacing = 275 shared 3:1
+		CHECK_RECT(edit, 10, 10, 480, 206);
+
+		bar.setVisible(true);
+		app.relayout();
+		CHECK(visible(a));
+		CHECK_RECT(a, 10, 10, 80, 30);
+
+		app.setLayout(NULL);
+	}
+
+	static void layoutIncremental() {
+		hdg::Application& app = *hdg::Application::instance;
+		hdg::headless::resize(app.getNativeHandle(), 400, 300);
+
+		std::vector<std::unique_ptr<hdg::Button>> buttons;
+		hdg::LayoutBox root(hdg::LayoutDirection::Column);
+		std::vector<hdg::LayoutBox*> rows;
+
+		for (int i = 0; i < 10; i++) {
+			rows.push_back(&root.addBox(hdg::LayoutDirection::Row, 20, 0));
+			for (int j = 0; j < 3; j++) {
+				buttons.push_back(std::unique_ptr<hdg::Button>(new hdg::Button("x")));
+				rows.back()->add(*buttons.back(), 50);
+			}
+		}
+
+		app.setLayout(&root);
+
+		//Spacing of one row moves only its own widgets
+		hdg::LayoutStats before = root.getStats();
+		rows[4]->setSpacing(10);
+		app.relayout();
+		hdg::LayoutStats after = root.getStats();
+
+		CHECK_EQ(after.boxesArranged - before.boxesArranged, 1ULL);
+		CHECK_EQ(after.widgetsChanged - before.widgetsChanged, 2ULL);
+		CHECK_RECT(*buttons[13], 60, 80, 50, 20);
+
+		//Nothing changed: nothing is arranged
+		before = after;
+		app.relayout();
+		after = root.getStats();
+		CHECK_EQ(after.boxesArranged - before.boxesArranged, 0ULL);
+		CHECK_EQ(after.widgetsChanged - before.widgetsChanged, 0ULL);
+
+		app.setLayout(NULL);
+	}
+
+	static void layoutHiddenBeforePlaced() {
+		hdg::Application& app = *hdg::Application::instance;
+		hdg::headless::resize(app.getNativeHandle(), 400, 300);
+
+		hdg::Button a("A"), b("B", 0, 0, 60, 20);
+
+		hdg::LayoutBox root(hdg::LayoutDirection::Column);
+		root.add(a, 30);
+		hdg::LayoutBox& hidden = root.add(b, 100);
+		hidden.setVisible(false);
+
+		app.setLayout(&root);
+
+		//Widget is only hidden, it keeps its own geometry
+		CHECK(!visible(b));
+		CHECK_RECT(b, 0, 0, 60, 20);
+
+		hidden.setVisible(true);
+		app.relayout();
+		CHECK(visible(b));
+		CHECK_RECT(b, 0, 30, 400, 100);
+
+		app.setLayout(NULL);
+	}
+
+	static void geometryTransaction() {
+		hdg::Button a("A"), b("B");
+
+		hdg::headless::resetStats();
+		{
+			hdg::GeometryTransaction transaction;
+			a.setPosition(10, 20);
+			b.setPosition(30, 40);
+			a.setPosition(15, 25);
+			CHECK_EQ(hdg::headless::stats().geometryChanges, 0ULL);
+		}
+
+		CHECK_EQ(hdg::headless::stats().geometryBatches, 1ULL);
+		CHECK_EQ(hdg::headless::getRect(a.getNativeHandle()).left, 15);
+		CHECK_EQ(hdg::headless::getRect(a.getNativeHandle()).top, 25);
+		CHECK_EQ(hdg::headless::getRect(b.getNativeHandle()).left, 30);
+
+		//Changes of widget destroyed during update are dropped, next update starts clean
+		{
+			hdg::GeometryTransaction transaction;
+			std::unique_ptr<hdg::Button> c(new hdg::Button("C"));
+			c->setPosition(50, 60);
+			b.setPosition(35, 45);
+		}
+
+		CHECK_EQ(hdg::headless::getRect(b.getNativeHandle()).left, 35);
+
+		{
+			hdg::GeometryTransaction transaction;
+			b.setSize(70, 20);
+		}
+
+		CHECK_EQ(hdg::headless::getRect(b.getNativeHandle()).left, 35);
+		CHECK_EQ(hdg::headless::getRect(b.getNativeHandle()).right, 105);
+	}
+
+	/*============== Forms ===========*/
+
+	enum { NameLabel, OkButton, CancelButton };
+
+	constexpr hdg::WidgetSpec testForm[] = {
+		hdg::form::label("Name:", 10, 10),
+		hdg::form::button("OK", 10, 40, 60, 24),
+		hdg::form::button("Cancel", 80, 40, 60, 24)
+	};
+
+	struct FormActions {
+		std::vector<size_t> clicked;
+
+		template <size_t I>
+		void operator()(std::integral_constant<size_t, I>) {
+			clicked.push_back(100 + I);
+		}
+
+		void operator()(std::integral_constant<size_t, OkButton>) {
+			clicked.push_back(OkButton);
+		}
+	};
+
+	static void formRoute() {
+		hdg::Application& app = *hdg::Application::instance;
+		hdg::StaticForm<hdg::form::count(testForm)> form(testForm, hdg::FormCreation::Lazy);
+
+		//Handler is set before widgets exist
+		FormActions actions;
+		form.route(&actions);
+		CHECK(!form.isMaterialized());
+
+		hdg::headless::click(form.getWidget(CancelButton)->getNativeHandle());
+		hdg::headless::click(form.getWidget(OkButton)->getNativeHandle());
+		hdg::headless::click(form.getWidget(NameLabel)->getNativeHandle());
+		app.pumpEvents();
+
+		CHECK_EQ(actions.clicked.size(), (size_t) 2);
+		if (actions.clicked.size() == 2) {
+			CHECK_EQ(actions.clicked[0], (size_t) 100 + CancelButton);
+			CHECK_EQ(actions.clicked[1], (size_t) OkButton);
+		}
+
+		form.route(nullptr);
+		hdg::headless::click(form.getWidget(OkButton)->getNativeHandle());
+		app.pumpEvents();
+		CHECK_EQ(actions.clicked.size(), (size_t) 2);
+	}
+
+	/*============== Images ===========*/
+
+	static void dirtyRegionMerging() {
+		hdg::DirtyRegion region;
+
+		//Adjacent rectangles of the same height become one
+		RECT left = {0, 0, 10, 10};
+		RECT right = {10, 0, 20, 10};
+		region.add(left);
+		region.add(right);
+		CHECK_EQ(region.getRects().size(), (size_t) 1);
+		CHECK_EQ(region.getRects()[0].right, 20);
+
+		//Distant rectangles stay apart
+		RECT far = {100, 100, 110, 110};
+		region.add(far);
+		CHECK_EQ(region.getRects().size(), (size_t) 2);
+
+		//Empty rectangles are ignored
+		RECT empty = {50, 50, 50, 60};
+		region.add(empty);
+		CHECK_EQ(region.getRects().size(), (size_t) 2);
+
+		//Amount is limited, and every added rectangle stays covered
+		region.clear();
+		std::vector<RECT> added;
+		for (int i = 0; i < 40; i++) {
+			RECT rect = {i * 37 % 500, i * 91 % 400, i * 37 % 500 + 8, i * 91 % 400 + 8};
+			added.push_back(rect);
+			region.add(rect);
+		}
+
+		const std::vector<RECT>& rects = region.getRects();
+		CHECK(rects.size() <= hdg::DirtyRegion::MaxRects);
+
+		bool covered = true;
+		for (size_t i = 0; i < added.size(); i++) {
+			bool inside = false;
+			for (size_t j = 0; j < rects.size(); j++) {
+				inside = inside || (rects[j].left <= added[i].left && rects[j].top <= added[i].top && rects[j].right >= added[i].right && rects[j].bottom >= added[i].bottom);
+			}
+			covered = covered && inside;
+		}
+		CHECK(covered);
+	}
+
+	static void putU16(std::string& out, uint32_t value) {
+		out += (char) (value & 0xFF);
+		out += (char) (value >> 8);
+	}
+
+	static void putU32(std::string& out, uint32_t value) {
+		putU16(out, value & 0xFFFF);
+		putU16(out, value >> 16);
+	}
+
+	//24-bit BMP, rows stored bottom-up and padded to 4 bytes
+	static std::string bmp24(int w, int h, const uint32_t* pixels) {
+		size_t stride = ((size_t) w * 3 + 3) / 4 * 4;
+
+		std::string file = "BM";
+		putU32(file, (uint32_t) (54 + stride * h));
+		putU32(file, 0);
+		putU32(file, 54);
+		putU32(file, 40);
+		putU32(file, (uint32_t) w);
+		putU32(file, (uint32_t) h);
+		putU16(file, 1);
+		putU16(file, 24);
+		for (int i = 0; i < 6; i++) putU32(file, 0);
+
+		for (int y = h - 1; y >= 0; y--) {
+			for (int x = 0; x < w; x++) {
+				uint32_t p = pixels[y * w + x];
+				file += (char) (p & 0xFF);
+				file += (char) ((p >> 8) & 0xFF);
+				file += (char) ((p >> 16) & 0xFF);
+			}
+			file.append(stride - w * 3, '\0');
+		}
+
+		return file;
+	}
+
+	static void decodeBmp() {
+		const uint32_t pixels[6] = {0xFF0000, 0x00FF00, 0x0000FF, 0x123456, 0xFFFFFF, 0x000000};
+		std::string file = bmp24(3, 2, pixels);
+
+		hdg::Raster raster;
+		bool alpha = true;
+		CHECK(hdg::decodeImage(file.data(), file.size(), raster, &alpha));
+		CHECK(!alpha);
+		CHECK_EQ(raster.getWidth(), 3);
+		CHECK_EQ(raster.getHeight(), 2);
+
+		for (int i = 0; i < 6; i++) CHECK_EQ(raster.getPixel(i % 3, i / 3), 0xFF000000u | pixels[i]);
+
+		//Truncated pixel data
+		CHECK(!hdg::decodeImage(file.data(), file.size() - 4, raster));
+		//Unsupported depth
+		std::string damaged = file;
+		damaged[28] = 16;
+		CHECK(!hdg::decodeImage(damaged.data(), damaged.size(), raster));
+	}
+
+	static void decodePnm() {
+		std::string ppm = "P6\n# comment\n2 1\n255\n";
+		ppm += std::string("\x10\x20\x30\xFF\x00\x80", 6);
+
+		hdg::Raster raster;
+		CHECK(hdg::decodeImage(ppm.data(), ppm.size(), raster));
+		CHECK_EQ(raster.getWidth(), 2);
+		CHECK_EQ(raster.getPixel(0, 0), 0xFF102030u);
+		CHECK_EQ(raster.getPixel(1, 0), 0xFFFF0080u);
+
+		//Graymap with maximum value 15 is scaled to 8 bits
+		std::string pgm = "P5 2 1 15 ";
+		pgm += std::string("\x0F\x05", 2);
+		CHECK(hdg::decodeImage(pgm.data(), pgm.size(), raster));
+		CHECK_EQ(raster.getPixel(0, 0), 0xFFFFFFFFu);
+		CHECK_EQ(raster.getPixel(1, 0), 0xFF555555u);
+
+		CHECK(!hdg::decodeImage(ppm.data(), ppm.size() - 1, raster));
+		CHECK(!hdg::decodeImage("P6 2", 4, raster));
+	}
+
+	/*============== Background work ===========*/
+
+	static void asyncOwner() {
+		hdg::Application& app = *hdg::Application::instance;
+
+		std::atomic<int> done(0);
+		int delivered = 0;
+		int ownerDelivered = 0;
+
+		hdg::Label* owner = new hdg::Label("Owner");
+		hdg::Async<int> owned = hdg::runAsync([&done](){ done++; return 1; });
+		owned.then(*owner, [&ownerDelivered](int value){ ownerDelivered += value; });
+
+		hdg::Async<int> plain = hdg::runAsync([&done](){ done++; return 2; });
+		plain.then([&delivered](int value){ delivered += value; });
+
+		delete owner;
+
+		for (int i = 0; i < 5000 && !(plain.isDone() && delivered != 0); i++) {
+			app.pumpEvents();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		app.pumpEvents();
+
+		CHECK_EQ(delivered, 2);
+		CHECK_EQ(ownerDelivered, 0);
+	}
+
+	static const test::Test tests[] = {
+		{"text/utf16_conversion", utf16Conversion},
+		{"text/utf16_invalid_input", utf16InvalidInput},
+		{"queue/post_order", postQueueOrder},
+		{"queue/post_producers", postQueueProducers},
+		{"queue/application_post", applicationPost},
+		{"timers/cascading", timerWheelCascading},
+		{"timers/cancel", timerWheelCancel},
+		{"events/click_dispatch", clickDispatch},
+		{"events/type_numbers", eventTypeNumbers},
+		{"widgets/label_text", labelText},
+		{"widgets/editbox_delta", editboxDelta},
+		{"widgets/editbox_user_input", editboxUserInput},
+		{"widgets/progressbar_coalesced", progressbarCoalesced},
+		{"widgets/pooled", pooledWidgets},
+		{"widgets/listview_cells", listViewCells},
+		{"layout/placement", layoutPlacement},
+		{"layout/incremental", layoutIncremental},
+		{"layout/hidden_before_placed", layoutHiddenBeforePlaced},
+		{"layout/geometry_transaction", geometryTransaction},
+		{"forms/route", formRoute},
+		{"images/dirty_region", dirtyRegionMerging},
+		{"images/decode_bmp", decodeBmp},
+		{"images/decode_pnm", decodePnm},
+		{"async/owner", asyncOwner}
+	};
+
+}
+
+int main(int argc, char** argv) {
+	std::string filter;
+	bool list = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (std::strncmp(argv[i], "--filter=", 9) == 0) {
+			filter = argv[i] + 9;
+		} else if (std::strcmp(argv[i], "--list") == 0) {
+			list = true;
+		} else {
+			std::fprintf(stderr, "Usage: %s [--filter=text] [--list]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	size_t count = sizeof(test::tests) / sizeof(test::tests[0]);
+
+	if (list) {
+		for (size_t i = 0; i < count; i++) std::printf("%s\n", test::tests[i].name);
+		return 0;
+	}
+
+	hdg::Application app(NULL, "Tests", 400, 300);
+
+	int run = 0;
+	int failed = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		const test::Test& t = test::tests[i];
+		if (std::string(t.name).find(filter) == std::string::npos) continue;
+
+		test::testFailures = 0;
+		t.body();
+		app.pumpEvents();
+
+		run++;
+		if (test::testFailures > 0) failed++;
+		test::failedChecks += test::testFailures;
+
+		std::printf("%-40s %s\n", t.name, test::testFailures == 0 ? "ok" : "FAILED");
+		std::fflush(stdout);
+	}
+
+	std::printf("%d tests, %d failed (%d checks)\n", run, failed, test::failedChecks);
+	return failed == 0 ? 0 : 1;
+}
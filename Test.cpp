@@ -13,49 +13,61 @@ public:
 			edit = new hdg::Editbox(hdg::EditboxStyle::Password, 400, 10, 200);
 			editTest = new hdg::Button("Get password value", 200, 50);
 
-			bombBtn = new hdg::Button("Open file and destroy", 100, 90);
+			//Pooled widget, owned by application
+			bombBtn = app.create<hdg::Button>("Open file and destroy", 100, 90);
 
 			bar = new hdg::Progressbar(false, 10, 125, 660, 20);
 			hdg::Font font("Arial", hdg::FontWeight::Bold, 18, true);
 			editDesc->setFont(font);
 
-			//Set event callback
-			app.setUserCallback(std::bind(&TestApp::eventCallback, this, std::placeholders::_1));
-	}
-
-	void eventCallback(hdg::Event ev) {
-		if (ev.type == hdg::EventType::Command) {
-
-			//ev.num1 holds control ID
-			//So we can use it for determining - which control sent the event
-
-			if (ev.num1 == button->getID()) {
+			//Set click handlers
+			button->onClick([this](hdg::Event ev) {
 				hdg::showMessageBox("You clicked the button!");
 				app.setTitle("Headgets Test application - already clicked");
 				button->disable();
 				bar->step();
-				return;
-			}
+			});
 
-			if (ev.num1 == editTest->getID()) {
+			editTest->onClick([this](hdg::Event ev) {
 				hdg::showMessageBox("Entered password is: "+edit->value());
 				bar->step();
-				return;
-			}
+			});
 
-			if (ev.num1 == bombBtn->getID()) {
-				bar->step();
-
-				hdg::OpenDialog dlg;
-				dlg.setTitle("Select an image file");
-				dlg.setRawFilter(hdg::FileFilters::ImageFiles);
-				if (dlg.open()) {
-					hdg::showMessageBox("You choosed file: "+dlg.getFilename());
-				}				
+			app.get(bombBtn)->onClick(std::bind(&TestApp::bombCallback, this, std::placeholders::_1));
+	}
 
-				delete bombBtn;
-			}
+	//Handler may safely destroy its own widget
+	void bombCallback(hdg::Event ev) {
+		bar->step();
+
+		hdg::OpenDialog dlg;
+		dlg.setTitle("Select an image file");
+		dlg.setRawFilter(hdg::FileFilters::ImageFiles);
+		if (dlg.open()) {
+			std::string path = dlg.getFilename();
+
+			//Reading the file would freeze the window, so it is done on thread pool
+			hdg::runAsync([path]() {
+				unsigned int sum = 0;
+				hdg::MappedFile file;
+
+				if (file.open(path)) {
+					file.forEachChunk([&](const char* data, size_t size, uint64_t offset) {
+						for (size_t i = 0; i < size; i++) sum = sum * 31 + (unsigned char) data[i];
+						return true;
+					});
+				}
+
+				return sum;
+			}).then(*label, [this, path](unsigned int sum) {
+				label->setText(path + " checksum: " + std::to_string(sum));
+			});
 		}
+
+		app.destroy(bombBtn);
+
+		//Handle of destroyed widget is stale now
+		assert(app.get(bombBtn) == NULL);
 	}
 
 	int run() {
@@ -71,7 +83,7 @@ private:
 	hdg::Label* editDesc;
 	hdg::Button* editTest;
 
-	hdg::Button* bombBtn;
+	hdg::Handle<hdg::Button> bombBtn;
 	hdg::Progressbar* bar;
 };
 